@@ -9,9 +9,15 @@ using namespace std;
 
 #include <bitset>
 #include <algorithm>
+#include <string.h>
+#include <set>
+#include <unordered_map>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
 
 //----------------------Function Declaration-------------------------
 unsigned int int_log2(uint32_t x);
+int mrc_main(int argc, char *argv[]);
 //-------------------------------------------------------------------
 
 typedef 
@@ -45,9 +51,16 @@ class CACHE {
    public:
       vector<vector<block_params>> BLOCK;
       CACHE* next;
+      CACHE* prev;         // upper level, back-invalidated when this level is inclusive
       vector<STREAM_BUFFER> StreamBuffer;
       bool hasStreamBuffer;
 
+      bool write_through;
+      bool write_allocate;
+      inclusion_policy_t inclusion;     // policy of this level with respect to prev
+      vector<uint32_t> WriteBuffer;     // FIFO of block addresses waiting to be written through
+      uint32_t write_buffer_size;
+
       uint32_t sets;
       uint32_t ways;
       uint32_t blocksize;
@@ -58,6 +71,11 @@ class CACHE {
       int num_write_miss;
       int num_write_back;
       int num_prefetch;
+      int num_write_through;     // writes sent to the next level by the write buffer
+      int num_write_coalesced;   // writes merged into a pending write buffer entry
+      int num_write_around;      // write-back no-write-allocate misses forwarded to the next level
+      int num_back_invalidation; // L1 blocks invalidated because this inclusive level evicted them
+      int num_victim_fill;       // upper level victims installed into this exclusive level
 
       void read_request(uint32_t addr);
       void write_request(uint32_t addr);  //Issue read request to next level for the missing block
@@ -72,6 +90,17 @@ class CACHE {
       void Prefetch_new_stream(uint32_t buffer_index, uint32_t buffer_block_tag);
       void count_num_prefetch(uint32_t buffer_index, uint32_t buffer_block_tag);
       void print_StreamBuffer_content();
+      int find_way(uint32_t set_index, uint32_t tag_value);
+      bool fetch_block(uint32_t addr);            // read the missing block from the next level, return its dirty bit
+      bool fetch_missing_block(uint32_t set_index, uint32_t addr);  // make_space + fetch_block in the order the next level needs
+      bool exclusive_read_request(uint32_t addr); // read request to an exclusive level, moves the block up
+      void fill_victim(uint32_t addr, bool dirty);
+      bool invalidate_block(uint32_t addr, bool &was_dirty);
+      void write_block(uint32_t set_index, uint32_t tag_value, uint32_t addr);  // perform the CPU's write on a resident block
+      void write_buffer_insert(uint32_t addr);
+      void write_buffer_drain();
+      void write_buffer_flush();
+      int memory_traffic();
 
       CACHE (uint32_t num_sets, uint32_t num_ways, uint32_t block_size, uint32_t PREF_N, uint32_t PREF_M)
             : sets(num_sets), ways(num_ways), blocksize(block_size)
@@ -90,12 +119,22 @@ class CACHE {
          }
 
          next = nullptr; // initialize the next level as main memory
+         prev = nullptr;
+         write_through = false;   // default: write-back, write-allocate, non-inclusive
+         write_allocate = true;
+         inclusion = NON_INCLUSIVE;
+         write_buffer_size = 0;
          num_read = 0;
          num_read_miss = 0;
          num_write = 0;
          num_write_miss = 0;
          num_write_back = 0;
          num_prefetch = 0;
+         num_write_through = 0;
+         num_write_coalesced = 0;
+         num_write_around = 0;
+         num_back_invalidation = 0;
+         num_victim_fill = 0;
 
          if(PREF_N != 0 && PREF_M != 0){
             hasStreamBuffer = true;
@@ -140,12 +179,10 @@ void CACHE::read_request(uint32_t addr){
          StreamBuffer_read_request(buffer_block_tag);    // prefetch the next M consecutive memory blocks into the Stream Buffer.
          // handle the miss in cache as usual, same as follow but skip the following read miss operation
          num_read_miss++;
-         make_space(index);
-         if (next != nullptr) {
-            next->read_request(addr);
-         }
+         bool fill_dirty = fetch_missing_block(index, addr);
          install_block(index, tag);
          LRU_update(index, tag);
+         if(fill_dirty) BLOCK[index][find_way(index, tag)].dirty = true;
          num_read ++;
          return;
       }else if(!cache_read_hit && StreamBuffer_read_hit){   // Scenario # 2 (benefit from and continue a prefetch stream): Requested block X misses in CACHE and hits in the Stream Buffer
@@ -173,14 +210,10 @@ void CACHE::read_request(uint32_t addr){
       num_read ++;
    }else{   // if read miss, issue read request to the next level
       num_read_miss ++;
-      make_space(index);
-      if (next != nullptr) {        // if next level is lower-level cache
-         next->read_request(addr);
-      }else{                        // next level is the main memory
-
-      }
+      bool fill_dirty = fetch_missing_block(index, addr);   // next level is lower-level cache or main memory
       install_block(index, tag); // install the block
       LRU_update(index, tag); // then update the block LRU information of this specific set
+      if(fill_dirty) BLOCK[index][find_way(index, tag)].dirty = true;  // dirty block moved up from an exclusive level
       //--------------
       // return the required byte (not implement details in the cache simulator)
       //--------------
@@ -206,6 +239,25 @@ void CACHE::write_request(uint32_t addr){
       }
    }
 
+   // An exclusive level only allocates blocks on victim fills, so its write misses bypass it as well
+   bool allocate = write_allocate && inclusion != EXCLUSIVE;
+
+   if(!cache_write_hit && !allocate){   // no-write-allocate: the write miss does not touch this level
+      num_write_miss ++;
+      num_write ++;
+      if(write_through){
+         write_buffer_insert(addr);    // written through like any other write
+      }else{
+         if(next != nullptr){
+            next->write_request(addr);   // forward the write to the next level
+         }else{
+                                 // next level is main memory
+         }
+         num_write_around ++;
+      }
+      return;
+   }
+
    bool StreamBuffer_read_hit = false;
    int MRU_buffer_index = -1;
    if(hasStreamBuffer){       // If this cache level has stream buffer, check it for a hit
@@ -217,19 +269,11 @@ void CACHE::write_request(uint32_t addr){
          StreamBuffer_read_request(buffer_block_tag);    // prefetch the next M consecutive memory blocks into the Stream Buffer.
          // handle the miss in cache as usual, same as follow but skip the following read miss operation
          num_write_miss++;
-         make_space(index);
-         if (next != nullptr) {
-            next->read_request(addr);
-         }
+         bool fill_dirty = fetch_missing_block(index, addr);
          install_block(index, tag);
          LRU_update(index, tag);
-         for(uint32_t block_index=0; block_index<ways; block_index++){
-            if(BLOCK[index][block_index].valid &&
-               BLOCK[index][block_index].address == tag){
-               BLOCK[index][block_index].dirty = true;  // set dirty bit
-               break;
-            }
-         }
+         if(fill_dirty) BLOCK[index][find_way(index, tag)].dirty = true;
+         write_block(index, tag, addr);
          num_write ++;
          return;
       }else if(!cache_write_hit && StreamBuffer_read_hit){   // Scenario # 2 (benefit from and continue a prefetch stream): Requested block X misses in CACHE and hits in the Stream Buffer
@@ -239,13 +283,7 @@ void CACHE::write_request(uint32_t addr){
          // --------------------------------------------------------------------
          install_block(index, tag);
          LRU_update(index, tag);
-         for(uint32_t block_index=0; block_index<ways; block_index++){
-            if(BLOCK[index][block_index].valid &&
-               BLOCK[index][block_index].address == tag){
-               BLOCK[index][block_index].dirty = true;  // set dirty bit
-               break;
-            }
-         }
+         write_block(index, tag, addr);
          num_write ++;
          Prefetch_new_stream(MRU_buffer_index, buffer_block_tag); // Next, manage the Stream Buffer
          return;               
@@ -258,37 +296,15 @@ void CACHE::write_request(uint32_t addr){
 
    if(cache_write_hit){
       LRU_update(index, tag);
-      //--------------
-      // perform the CPU's write (not implement details in the cache simulator)
-      //--------------
-      for(uint32_t block_index=0; block_index<ways; block_index++){
-         if(BLOCK[index][block_index].valid &&
-            BLOCK[index][block_index].address == tag){
-            BLOCK[index][block_index].dirty = true;  // set dirty bit
-            break;
-         }
-      }
+      write_block(index, tag, addr);   // perform the CPU's write
       num_write ++;
    }else{
       num_write_miss ++;
-      make_space(index);
-      if(next != nullptr){
-         next->read_request(addr);   // issue read request to next level
-      }else{
-                                 // next level is main memory
-      }
+      bool fill_dirty = fetch_missing_block(index, addr);   // issue read request to next level (or main memory)
       install_block(index, tag);
       LRU_update(index, tag);
-      //--------------
-      // perform the CPU's write (not implement details in the cache simulator)
-      //--------------
-      for(uint32_t block_index=0; block_index<ways; block_index++){
-         if(BLOCK[index][block_index].valid &&
-            BLOCK[index][block_index].address == tag){
-            BLOCK[index][block_index].dirty = true;  // set dirty bit
-            break;
-         }
-      }
+      if(fill_dirty) BLOCK[index][find_way(index, tag)].dirty = true;
+      write_block(index, tag, addr);   // perform the CPU's write
       num_write ++;
 
    }
@@ -362,12 +378,36 @@ void CACHE::make_space(uint32_t set_index){
       }
    }
 
+   uint32_t victim_tag = BLOCK[set_index][LRU_block_index].address;
+   uint32_t block_addr = (victim_tag << int_log2(sets)) | set_index;
+   uint32_t victim_addr = block_addr << int_log2(blocksize);
+
+   // if this level is inclusive, the victim block must also leave the upper level
+   if(inclusion == INCLUSIVE && prev != nullptr){
+      bool upper_dirty = false;
+      if(prev->invalidate_block(victim_addr, upper_dirty)){
+         num_back_invalidation ++;
+         if(upper_dirty){
+            BLOCK[set_index][LRU_block_index].dirty = true;   // the upper level's newer data leaves with the victim
+         }
+      }
+   }
+
+   // if the next level is exclusive, every victim block (clean or dirty) is moved into it
+   if(next != nullptr && next->inclusion == EXCLUSIVE){
+      bool victim_dirty = BLOCK[set_index][LRU_block_index].dirty;
+      next->fill_victim(victim_addr, victim_dirty);
+      if(victim_dirty){
+         BLOCK[set_index][LRU_block_index].dirty = false;
+         num_write_back ++;
+      }
+      BLOCK[set_index][LRU_block_index].valid = false;   // the victim has left, keep its LRU bits for install_block
+      return;
+   }
+
    // if this victim block is dirty, write of the victim block to next level
    if(BLOCK[set_index][LRU_block_index].dirty == true){
       if(next != nullptr){
-         uint32_t victim_tag = BLOCK[set_index][LRU_block_index].address;
-         uint32_t block_addr = (victim_tag << int_log2(sets)) | set_index;
-         uint32_t victim_addr = block_addr << int_log2(blocksize);
          next->write_request(victim_addr); // if next level is lower level cache, send write request
       }else{   // next level is main memory
          // write back to main memory, not show detail here
@@ -375,6 +415,160 @@ void CACHE::make_space(uint32_t set_index){
       BLOCK[set_index][LRU_block_index].dirty = false;   // update the block's dirty bit
       num_write_back ++;
    }
+   // Invalidate the victim now: an inclusive next level may back-invalidate another block of this set
+   // before install_block runs, and the new block must not take that way while the victim stays resident.
+   BLOCK[set_index][LRU_block_index].valid = false;
+}
+
+int CACHE::find_way(uint32_t set_index, uint32_t tag_value){
+   for(uint32_t block_index=0; block_index<ways; block_index++){
+      if(BLOCK[set_index][block_index].valid &&
+         BLOCK[set_index][block_index].address == tag_value){
+         return block_index;
+      }
+   }
+   return -1;
+}
+
+bool CACHE::fetch_block(uint32_t addr){
+   if(next == nullptr){
+      return false;                 // next level is main memory
+   }
+   if(next->inclusion == EXCLUSIVE){
+      return next->exclusive_read_request(addr);   // the block moves up, possibly dirty
+   }
+   next->read_request(addr);
+   return false;
+}
+
+bool CACHE::fetch_missing_block(uint32_t set_index, uint32_t addr){
+   bool fill_dirty;
+   if(next != nullptr && next->inclusion == EXCLUSIVE){
+      // swap with the exclusive level: take the block out first, so the victim fill cannot evict it
+      fill_dirty = fetch_block(addr);
+      make_space(set_index);
+   }else{
+      // the victim is written back before the missing block is read
+      make_space(set_index);
+      fill_dirty = fetch_block(addr);
+   }
+   return fill_dirty;
+}
+
+bool CACHE::exclusive_read_request(uint32_t addr){
+   // Same as read_request, but a hit hands the block over to the upper level and a miss does not allocate:
+   // the block is fetched from main memory straight into the upper level.
+   uint32_t tag, index;
+   unsigned int num_block_offset = int_log2(blocksize);
+   unsigned int num_index_bits = int_log2(sets);
+   uint32_t mask = ((1 << num_index_bits) - 1);
+   index = (addr >> num_block_offset) & mask;
+   tag = addr >> (num_block_offset + num_index_bits);
+
+   int hit_way = find_way(index, tag);
+   num_read ++;
+
+   if(hasStreamBuffer){
+      uint32_t buffer_block_tag = addr >> num_block_offset;
+      int MRU_buffer_index = check_StreamBuffer(buffer_block_tag);
+      if(MRU_buffer_index >= 0){
+         Prefetch_new_stream(MRU_buffer_index, buffer_block_tag);   // Scenario #2 and #4: the stream buffer supplies or follows the block
+         if(hit_way < 0) return false;
+      }else if(hit_way < 0){
+         StreamBuffer_read_request(buffer_block_tag);                 // Scenario #1: start a new prefetch stream
+      }
+   }
+
+   if(hit_way < 0){
+      num_read_miss ++;
+      return false;
+   }
+   bool was_dirty = false;
+   invalidate_block(addr, was_dirty);
+   return was_dirty;
+}
+
+void CACHE::fill_victim(uint32_t addr, bool dirty){
+   uint32_t tag, index;
+   unsigned int num_block_offset = int_log2(blocksize);
+   unsigned int num_index_bits = int_log2(sets);
+   uint32_t mask = ((1 << num_index_bits) - 1);
+   index = (addr >> num_block_offset) & mask;
+   tag = addr >> (num_block_offset + num_index_bits);
+
+   num_victim_fill ++;
+   if(find_way(index, tag) < 0){
+      make_space(index);
+      install_block(index, tag);
+   }
+   LRU_update(index, tag);
+   if(dirty){
+      write_block(index, tag, addr);
+   }
+}
+
+bool CACHE::invalidate_block(uint32_t addr, bool &was_dirty){
+   uint32_t tag, index;
+   unsigned int num_block_offset = int_log2(blocksize);
+   unsigned int num_index_bits = int_log2(sets);
+   uint32_t mask = ((1 << num_index_bits) - 1);
+   index = (addr >> num_block_offset) & mask;
+   tag = addr >> (num_block_offset + num_index_bits);
+
+   int way = find_way(index, tag);
+   if(way < 0){
+      return false;
+   }
+   was_dirty = BLOCK[index][way].dirty;
+   BLOCK[index][way].valid = false;   // the LRU bits are kept, install_block reuses invalid blocks first
+   BLOCK[index][way].dirty = false;
+   BLOCK[index][way].address = 0;
+   return true;
+}
+
+void CACHE::write_block(uint32_t set_index, uint32_t tag_value, uint32_t addr){
+   if(write_through){
+      write_buffer_insert(addr);   // the block stays clean, the write goes to the next level
+   }else{
+      BLOCK[set_index][find_way(set_index, tag_value)].dirty = true;  // set dirty bit
+   }
+}
+
+void CACHE::write_buffer_insert(uint32_t addr){
+   uint32_t buffer_block_tag = addr >> int_log2(blocksize);
+   for(uint32_t i=0; i<WriteBuffer.size(); i++){
+      if(WriteBuffer[i] == buffer_block_tag){
+         num_write_coalesced ++;   // merge with the pending write to the same block
+         return;
+      }
+   }
+   WriteBuffer.push_back(buffer_block_tag);
+   if(WriteBuffer.size() > write_buffer_size){
+      write_buffer_drain();        // buffer full (or no buffer): retire the oldest entry
+   }
+}
+
+void CACHE::write_buffer_drain(){
+   uint32_t buffer_block_tag = WriteBuffer[0];
+   WriteBuffer.erase(WriteBuffer.begin());
+   if(next != nullptr){
+      next->write_request(buffer_block_tag << int_log2(blocksize));
+   }else{
+      // write to main memory, not show detail here
+   }
+   num_write_through ++;
+}
+
+void CACHE::write_buffer_flush(){
+   while(!WriteBuffer.empty()){
+      write_buffer_drain();
+   }
+}
+
+int CACHE::memory_traffic(){
+   // blocks read from memory plus blocks written to it, for this level as the last level
+   int fetches = num_read_miss + (write_allocate && inclusion != EXCLUSIVE ? num_write_miss : 0);
+   return fetches + num_write_back + num_prefetch + num_write_through + num_write_around;
 }
 
 void CACHE::print_cache_content(){
@@ -508,6 +702,147 @@ void CACHE::print_StreamBuffer_content(){
 }
 
 
+// Red-black tree with order statistics, used to count the distinct blocks touched since a block's last access
+typedef __gnu_pbds::tree<uint64_t, __gnu_pbds::null_type, less<uint64_t>, __gnu_pbds::rb_tree_tag,
+                         __gnu_pbds::tree_order_statistics_node_update> ordered_timestamps;
+
+/*
+   SHARDS-style spatially sampled reuse-distance profiler for fully-associative LRU.
+   A block is sampled iff hash(block) mod P < threshold, so every reference to a sampled block is seen
+   and its reuse distance among sampled blocks, scaled by 1/R, estimates the true LRU stack distance.
+   If SAMPLE_MAX != 0 the number of tracked blocks is bounded: when it is exceeded, the threshold is lowered
+   to the largest tracked hash, those blocks are dropped and the histogram is rescaled to the new rate.
+*/
+class MRC_SAMPLER{
+   public:
+      static const uint32_t HASH_MODULUS = 1 << 24;   // P
+
+      uint32_t blocksize;
+      uint32_t max_blocks;
+      uint32_t sample_max;
+      uint32_t threshold;       // T, sampling rate R = T / P
+
+      uint64_t num_ref;         // all references in the trace
+      uint64_t num_sampled;     // references to sampled blocks
+      uint64_t timestamp;
+      vector<uint32_t> curve_blocks;   // cache sizes (in blocks) on the curve: powers of two, then max_blocks
+      vector<double> histogram; // rescaled reference counts; histogram[i] holds scaled reuse distances d with
+                                // curve_blocks[i-1] <= d < curve_blocks[i], the last bin also holds cold misses
+
+      unordered_map<uint32_t, uint64_t> last_access;   // tracked block -> timestamp of its last access
+      ordered_timestamps access_time;                  // last-access timestamps of all tracked blocks
+      set<pair<uint32_t, uint32_t>> block_hash;        // (hash, block) of all tracked blocks
+
+      void access(uint32_t addr);
+      double rate();
+      double miss_rate(uint32_t point);
+      bool resolvable(uint32_t point);
+      void lower_threshold();
+      static uint32_t hash(uint32_t block);
+
+      MRC_SAMPLER (uint32_t block_size, uint32_t max_size, double sample_rate, uint32_t max_sampled)
+            : blocksize(block_size), max_blocks(max_size / block_size), sample_max(max_sampled)
+      {
+         threshold = (uint32_t)(sample_rate * HASH_MODULUS);
+         if(threshold == 0) threshold = 1;
+         if(threshold > HASH_MODULUS) threshold = HASH_MODULUS;
+         num_ref = 0;
+         num_sampled = 0;
+         timestamp = 0;
+         // Power-of-two numbers of blocks, plus the last whole block of max_size
+         for(uint32_t blocks=1; blocks != 0 && blocks <= max_blocks; blocks <<= 1){
+            curve_blocks.push_back(blocks);
+         }
+         if(curve_blocks.back() != max_blocks){
+            curve_blocks.push_back(max_blocks);
+         }
+         histogram.assign(curve_blocks.size() + 1, 0.0);
+      };
+};
+
+void MRC_SAMPLER::access(uint32_t addr){
+   num_ref ++;
+   uint32_t block = addr >> int_log2(blocksize);
+   uint32_t block_hash_value = hash(block) & (HASH_MODULUS - 1);
+   if(block_hash_value >= threshold){
+      return;  // block is not sampled
+   }
+   num_sampled ++;
+
+   unordered_map<uint32_t, uint64_t>::iterator it = last_access.find(block);
+   if(it != last_access.end()){
+      // number of distinct sampled blocks accessed since the last access of this block
+      uint64_t distance = access_time.size() - access_time.order_of_key(it->second) - 1;
+      double scaled_distance = (double)distance / rate();
+      // bin = number of curve points <= scaled distance
+      uint32_t bin = upper_bound(curve_blocks.begin(), curve_blocks.end(), scaled_distance) - curve_blocks.begin();
+      histogram[bin] += 1.0;
+      access_time.erase(it->second);
+      it->second = timestamp;
+      access_time.insert(timestamp);
+   }else{
+      histogram[curve_blocks.size()] += 1.0;  // cold miss
+      last_access[block] = timestamp;
+      access_time.insert(timestamp);
+      block_hash.insert(make_pair(block_hash_value, block));
+      if(sample_max != 0 && last_access.size() > sample_max){
+         lower_threshold();
+      }
+   }
+   timestamp ++;
+}
+
+double MRC_SAMPLER::rate(){
+   return (double)threshold / (double)HASH_MODULUS;
+}
+
+double MRC_SAMPLER::miss_rate(uint32_t point){
+   // a reference with reuse distance d hits in a cache of C blocks iff d < C
+   double misses = 0.0;
+   for(uint32_t bin=point+1; bin<histogram.size(); bin++){
+      misses += histogram[bin];
+   }
+   // SHARDS_adj: normalize by the expected number of sampled references rather than the observed one
+   double expected = (double)num_ref * rate();
+   if(expected <= 0.0) return 0.0;
+   double ratio = misses / expected;
+   if(ratio > 1.0) ratio = 1.0;
+   return ratio;
+}
+
+bool MRC_SAMPLER::resolvable(uint32_t point){
+   // scaled distances come in steps of 1/R blocks, so smaller caches cannot be told apart
+   return (double)curve_blocks[point] * rate() >= 1.0;
+}
+
+void MRC_SAMPLER::lower_threshold(){
+   double old_rate = rate();
+   threshold = block_hash.rbegin()->first;   // the new threshold excludes the largest tracked hash
+   if(threshold == 0) threshold = 1;
+   while(!block_hash.empty() && block_hash.rbegin()->first >= threshold){
+      uint32_t block = block_hash.rbegin()->second;
+      access_time.erase(last_access[block]);
+      last_access.erase(block);
+      block_hash.erase(prev(block_hash.end()));
+   }
+   // rescale the counts collected so far to the lower rate
+   double scale = rate() / old_rate;
+   for(uint32_t bin=0; bin<histogram.size(); bin++){
+      histogram[bin] *= scale;
+   }
+}
+
+uint32_t MRC_SAMPLER::hash(uint32_t block){
+   // MurmurHash3 finalizer
+   block ^= block >> 16;
+   block *= 0x85ebca6b;
+   block ^= block >> 13;
+   block *= 0xc2b2ae35;
+   block ^= block >> 16;
+   return block;
+}
+
+
 /*  "argc" holds the number of command-line arguments.
     "argv[]" holds the arguments themselves.
 
@@ -527,8 +862,13 @@ int main (int argc, char *argv[]) {
    uint32_t addr;		// This variable holds the request's address obtained from the trace.
 				// The header file <inttypes.h> above defines signed and unsigned integers of various sizes in a machine-agnostic way.  "uint32_t" is an unsigned integer of 32 bits.
 
+   // "./sim mrc ..." prints a miss-ratio curve instead of simulating one configuration.
+   if (argc >= 2 && strcmp(argv[1], "mrc") == 0) {
+      return mrc_main(argc, argv);
+   }
+
    // Exit with an error if the number of command-line arguments is incorrect.
-   if (argc != 9) {
+   if (argc < 9) {
       printf("Error: Expected 8 command-line arguments but was provided %d.\n", (argc - 1));
       exit(EXIT_FAILURE);
    }
@@ -543,6 +883,53 @@ int main (int argc, char *argv[]) {
    params.PREF_M    = (uint32_t) atoi(argv[7]);
    trace_file       = argv[8];
 
+   // Optional policy arguments after the trace file, e.g. "wt wbuf=4 nwa exclusive".
+   // Without them the simulator is write-back, write-allocate and non-inclusive.
+   params.WRITE_THROUGH  = false;
+   params.WRITE_ALLOCATE = true;
+   params.WBUF_SIZE      = 8;
+   params.INCLUSION      = NON_INCLUSIVE;
+   bool has_wbuf_arg = false;
+   for (int i = 9; i < argc; i++) {
+      if (strcmp(argv[i], "wt") == 0) {
+         params.WRITE_THROUGH = true;
+      } else if (strcmp(argv[i], "wb") == 0) {
+         params.WRITE_THROUGH = false;
+      } else if (strcmp(argv[i], "nwa") == 0) {
+         params.WRITE_ALLOCATE = false;
+      } else if (strcmp(argv[i], "wa") == 0) {
+         params.WRITE_ALLOCATE = true;
+      } else if (strncmp(argv[i], "wbuf=", 5) == 0) {
+         char *end;
+         long entries = strtol(argv[i] + 5, &end, 10);
+         if (argv[i][5] == '\0' || *end != '\0' || entries < 0) {
+            printf("Error: Invalid write buffer size %s.\n", argv[i] + 5);
+            exit(EXIT_FAILURE);
+         }
+         params.WBUF_SIZE = (uint32_t) entries;
+         has_wbuf_arg = true;
+      } else if (strcmp(argv[i], "inclusive") == 0) {
+         params.INCLUSION = INCLUSIVE;
+      } else if (strcmp(argv[i], "exclusive") == 0) {
+         params.INCLUSION = EXCLUSIVE;
+      } else if (strcmp(argv[i], "non-inclusive") == 0) {
+         params.INCLUSION = NON_INCLUSIVE;
+      } else {
+         printf("Error: Unknown policy argument %s.\n", argv[i]);
+         exit(EXIT_FAILURE);
+      }
+   }
+   // Reject policies that would be printed but have no effect
+   if (has_wbuf_arg && !params.WRITE_THROUGH) {
+      printf("Error: wbuf=<N> requires the write-through policy (wt).\n");
+      exit(EXIT_FAILURE);
+   }
+   if (params.INCLUSION != NON_INCLUSIVE && (params.L2_SIZE == 0 || params.L2_ASSOC == 0)) {
+      printf("Error: %s requires an L2 cache.\n", params.INCLUSION == INCLUSIVE ? "inclusive" : "exclusive");
+      exit(EXIT_FAILURE);
+   }
+   bool has_policy_args = (argc > 9);
+
    // Open the trace file for reading.
    fp = fopen(trace_file, "r");
    if (fp == (FILE *) NULL) {
@@ -561,6 +948,16 @@ int main (int argc, char *argv[]) {
    printf("PREF_N:     %u\n", params.PREF_N);
    printf("PREF_M:     %u\n", params.PREF_M);
    printf("trace_file: %s\n", trace_file);
+   if (has_policy_args) {
+      if (params.WRITE_THROUGH) {
+         printf("WRITE_POLICY: write-through, %u-entry write buffer\n", params.WBUF_SIZE);
+      } else {
+         printf("WRITE_POLICY: write-back\n");
+      }
+      printf("ALLOCATION:   %s\n", params.WRITE_ALLOCATE ? "write-allocate" : "no-write-allocate");
+      printf("INCLUSION:    %s\n", params.INCLUSION == INCLUSIVE ? "inclusive" :
+                                     params.INCLUSION == EXCLUSIVE ? "exclusive" : "non-inclusive");
+   }
    printf("\n");
 
    // L1 cache parameters calculation and configuration setup
@@ -575,8 +972,18 @@ int main (int argc, char *argv[]) {
    }
    CACHE L2_cache(L2_sets, params.L2_ASSOC, params.BLOCKSIZE, 0, 0); // Set prefetch unit size later if L2 has it
 
+   // Write policy applies to every level, inclusion policy to L2 with respect to L1
+   CACHE* levels[2] = {&L1_cache, &L2_cache};
+   for (int i = 0; i < 2; i++) {
+      levels[i]->write_through = params.WRITE_THROUGH;
+      levels[i]->write_allocate = params.WRITE_ALLOCATE;
+      levels[i]->write_buffer_size = params.WBUF_SIZE;
+   }
+
    if (params.L2_SIZE != 0 && params.L2_ASSOC !=0){                  // L2 cache level exists
       L1_cache.next = &L2_cache;                                     // Set L2 cache as the next level of L1 cache
+      L2_cache.prev = &L1_cache;
+      L2_cache.inclusion = params.INCLUSION;
       if(params.PREF_N != 0 && params.PREF_M != 0){
          L2_cache.StreamBuffer_Setup(params.PREF_N, params.PREF_M);  // Valid prefetch unit size, so set it for L2 cache
       }
@@ -598,6 +1005,10 @@ int main (int argc, char *argv[]) {
       }
    }
 
+   // Retire the writes still waiting in the write buffers, upper level first
+   L1_cache.write_buffer_flush();
+   L2_cache.write_buffer_flush();
+
    double L1_miss_rate = (double)(L1_cache.num_read_miss + L1_cache.num_write_miss) / (double)(L1_cache.num_read + L1_cache.num_write);
    double L2_miss_rate = 0.0000;
    int total_memory_traffic = 0;
@@ -610,9 +1021,9 @@ int main (int argc, char *argv[]) {
       cout << "===== L2 contents =====" << endl;
       L2_cache.print_cache_content();
       L2_miss_rate = (double)L2_cache.num_read_miss / (double)L2_cache.num_read;
-      total_memory_traffic = L2_cache.num_read_miss + L2_cache.num_write_miss + L2_cache.num_write_back + L2_cache.num_prefetch; // L2 prefetch to be added
+      total_memory_traffic = L2_cache.memory_traffic();
    }else{
-      total_memory_traffic = L1_cache.num_read_miss + L1_cache.num_write_miss + L1_cache.num_write_back + L1_cache.num_prefetch; // L1 prefetch to be added
+      total_memory_traffic = L1_cache.memory_traffic();
    }
 
    if(params.PREF_N != 0 && params.PREF_M != 0){
@@ -647,6 +1058,147 @@ int main (int argc, char *argv[]) {
    cout << "o. L2 writebacks:              " << L2_cache.num_write_back << endl;
    cout << "p. L2 prefetches:              " << L2_cache.num_prefetch << endl;
    cout << "q. memory traffic:             " << total_memory_traffic << endl;
+   if (has_policy_args) {
+      // write traffic leaving each level and the cost of enforcing the inclusion policy
+      cout << "r. L1 write-throughs:          " << L1_cache.num_write_through << endl;
+      cout << "s. L1 coalesced writes:        " << L1_cache.num_write_coalesced << endl;
+      cout << "t. L1 write-arounds:           " << L1_cache.num_write_around << endl;
+      cout << "u. L2 write-throughs:          " << L2_cache.num_write_through << endl;
+      cout << "v. L2 coalesced writes:        " << L2_cache.num_write_coalesced << endl;
+      cout << "w. L2 write-arounds:           " << L2_cache.num_write_around << endl;
+      cout << "x. L2 back-invalidations:      " << L2_cache.num_back_invalidation << endl;
+      cout << "y. L2 victim fills:            " << L2_cache.num_victim_fill << endl;
+   }
+   return(0);
+}
+
+
+/*  Miss-ratio-curve mode.
+
+    Example:
+    ./sim mrc 32 262144 0.01 8192 gcc_trace.txt verify
+    argv[2] = BLOCKSIZE
+    argv[3] = MAX_SIZE     (the curve covers BLOCKSIZE, 2*BLOCKSIZE, 4*BLOCKSIZE, ... and MAX_SIZE bytes)
+    argv[4] = SAMPLE_RATE  (initial sampling rate, 1 = exact)
+    argv[5] = SAMPLE_MAX   (max sampled blocks tracked, 0 = unbounded)
+    argv[6] = trace file
+    argv[7] = "verify"     (optional: compare against the exact fully-associative CACHE at each point)
+*/
+int mrc_main(int argc, char *argv[]) {
+   FILE *fp;
+   char *trace_file;
+   mrc_params_t params;
+   char rw;
+   uint32_t addr;
+
+   if (argc != 7 && argc != 8) {
+      printf("Error: Expected 5 or 6 command-line arguments after \"mrc\" but was provided %d.\n", (argc - 2));
+      exit(EXIT_FAILURE);
+   }
+
+   params.BLOCKSIZE   = (uint32_t) atoi(argv[2]);
+   params.MAX_SIZE    = (uint32_t) atoi(argv[3]);
+   params.SAMPLE_RATE = atof(argv[4]);
+   params.SAMPLE_MAX  = (uint32_t) atoi(argv[5]);
+   trace_file         = argv[6];
+   params.VERIFY      = false;
+   if (argc == 8) {
+      if (strcmp(argv[7], "verify") != 0) {
+         printf("Error: Unknown argument %s, expected \"verify\".\n", argv[7]);
+         exit(EXIT_FAILURE);
+      }
+      params.VERIFY = true;
+   }
+
+   if (params.BLOCKSIZE == 0 || params.MAX_SIZE < params.BLOCKSIZE) {
+      printf("Error: MAX_SIZE must be at least BLOCKSIZE.\n");
+      exit(EXIT_FAILURE);
+   }
+   if (params.SAMPLE_RATE <= 0.0 || params.SAMPLE_RATE > 1.0) {
+      printf("Error: SAMPLE_RATE must be in (0, 1].\n");
+      exit(EXIT_FAILURE);
+   }
+
+   fp = fopen(trace_file, "r");
+   if (fp == (FILE *) NULL) {
+      printf("Error: Unable to open file %s\n", trace_file);
+      exit(EXIT_FAILURE);
+   }
+
+   printf("===== MRC configuration =====\n");
+   printf("BLOCKSIZE:   %u\n", params.BLOCKSIZE);
+   printf("MAX_SIZE:    %u\n", params.MAX_SIZE);
+   printf("SAMPLE_RATE: %g\n", params.SAMPLE_RATE);
+   printf("SAMPLE_MAX:  %u\n", params.SAMPLE_MAX);
+   printf("trace_file:  %s\n", trace_file);
+   printf("\n");
+
+   // Single streaming pass over the trace; reads and writes both touch the block (write-allocate).
+   MRC_SAMPLER sampler(params.BLOCKSIZE, params.MAX_SIZE, params.SAMPLE_RATE, params.SAMPLE_MAX);
+   while (fscanf(fp, "%c %x\n", &rw, &addr) == 2) {
+      if (rw != 'r' && rw != 'w') {
+         printf("Error: Unknown request type %c.\n", rw);
+         exit(EXIT_FAILURE);
+      }
+      sampler.access(addr);
+   }
+
+   cout << "===== Miss ratio curve (fully-associative LRU) =====" << endl;
+   if (params.VERIFY) {
+      cout << "  cache size    miss rate    exact miss rate    abs error" << endl;
+   } else {
+      cout << "  cache size    miss rate" << endl;
+   }
+
+   double sum_error = 0.0;
+   double max_error = 0.0;
+   int num_points = 0;
+
+   // Points below the sampling resolution are marked with '*' and left out of the error
+   vector<uint32_t> &curve_blocks = sampler.curve_blocks;
+   for (uint32_t point = 0; point < curve_blocks.size(); point++) {
+      uint32_t size = curve_blocks[point] * params.BLOCKSIZE;
+      double estimate = sampler.miss_rate(point);
+      bool resolvable = sampler.resolvable(point);
+      cout << setw(12) << size << "    " << fixed << setprecision(4) << estimate << (resolvable ? " " : "*");
+      if (params.VERIFY) {
+         // exact simulation: a single-set CACHE with size / BLOCKSIZE ways
+         CACHE exact_cache(1, curve_blocks[point], params.BLOCKSIZE, 0, 0);
+         rewind(fp);
+         while (fscanf(fp, "%c %x\n", &rw, &addr) == 2) {
+            if (rw == 'r') {
+               exact_cache.read_request(addr);
+            } else {
+               exact_cache.write_request(addr);
+            }
+         }
+         double exact = (double)(exact_cache.num_read_miss + exact_cache.num_write_miss) / (double)(exact_cache.num_read + exact_cache.num_write);
+         double error = estimate > exact ? estimate - exact : exact - estimate;
+         if (resolvable) {
+            sum_error += error;
+            if (error > max_error) max_error = error;
+         }
+         cout << "   " << setw(15) << exact << "    " << setw(9) << error;
+      }
+      cout << endl;
+      if (resolvable) num_points ++;
+   }
+   if (num_points < (int)curve_blocks.size()) {
+      cout << "* below the sampling resolution of 1/R blocks, not a usable estimate" << endl;
+   }
+   fclose(fp);
+
+   cout << "===== MRC measurements =====" << endl;
+   cout << "a. references:                 " << sampler.num_ref << endl;
+   cout << "b. sampled references:         " << sampler.num_sampled << endl;
+   cout << "c. tracked blocks:             " << sampler.last_access.size() << endl;
+   cout << "d. final sampling rate:        " << fixed << setprecision(6) << sampler.rate() << endl;
+   cout << "e. resolvable points:          " << num_points << endl;
+   if (params.VERIFY && num_points > 0) {
+      // over the resolvable points only
+      cout << "f. mean abs error:             " << fixed << setprecision(4) << sum_error / num_points << endl;
+      cout << "g. max abs error:              " << fixed << setprecision(4) << max_error << endl;
+   }
    return(0);
 }
 
@@ -1,6 +1,13 @@
 #ifndef SIM_CACHE_H
 #define SIM_CACHE_H
 
+// Relation between the blocks of L2 and the blocks of L1
+typedef enum {
+   NON_INCLUSIVE,   // no enforcement (default)
+   INCLUSIVE,       // L2 evictions back-invalidate L1
+   EXCLUSIVE        // L1 fills bypass L2, L1 victims fill L2
+} inclusion_policy_t;
+
 typedef 
 struct {
    uint32_t BLOCKSIZE;
@@ -10,8 +17,22 @@ struct {
    uint32_t L2_ASSOC;
    uint32_t PREF_N;
    uint32_t PREF_M;
+   bool     WRITE_THROUGH;     // optional "wt": write-through instead of write-back
+   bool     WRITE_ALLOCATE;    // optional "nwa" clears it: write misses bypass the cache
+   uint32_t WBUF_SIZE;         // optional "wbuf=<N>": entries of the coalescing write buffer (write-through only)
+   inclusion_policy_t INCLUSION;  // optional "inclusive" / "exclusive"
 } cache_params_t;
 
 // Put additional data structures here as per your requirement.
 
+// Parameters of the miss-ratio-curve (MRC) mode: ./sim mrc ...
+typedef
+struct {
+   uint32_t BLOCKSIZE;
+   uint32_t MAX_SIZE;      // largest cache size (bytes) on the curve
+   double   SAMPLE_RATE;   // initial spatial sampling rate, 0 < R <= 1
+   uint32_t SAMPLE_MAX;    // max number of sampled blocks tracked, 0 = unbounded (fixed rate)
+   bool     VERIFY;        // also run the exact CACHE for each point and report the error
+} mrc_params_t;
+
 #endif